@@ -10,8 +10,23 @@
 
 static virDomainPtr *domains = NULL;
 
-//tracks the load for each PCPU
-static unsigned long long cpuTimes[MAX_CPUS] = {0};
+//a pin mapping policy. The active policy pins vcpus through virDomainPinVcpu,
+//shadow policies run on the same stats but only log what they would have done.
+struct pinPolicy
+{
+	const char *name;
+	//returns the pcpu a vcpu should be pinned to given the expected workload
+	int (*choosePcpu)(unsigned long long *workload, int nPcpus, int currPcpu);
+	bool actuate;
+	//tracks the load for each PCPU as seen by this policy
+	unsigned long long cpuTimes[MAX_CPUS];
+	//load handed to each PCPU during the last round
+	unsigned long long roundLoad[MAX_CPUS];
+	//pcpu each vcpu would be on if this policy had been actuated, -1 if unknown.
+	//indexed by [domain][vcpu], only used by policies that are not actuated.
+	int **pins;
+	int nPins;
+};
 
 struct virDomainWindow
 {
@@ -144,6 +159,53 @@ int getNextPcpuIndex(unsigned long long *cpuTimes, int max, int startIndex=0)
 	return pcpuPin;
 }
 
+//keep current pin if it is not mapped yet this round
+int choosePcpuSticky(unsigned long long *workload, int nPcpus, int currPcpu)
+{
+	return getNextPcpuIndex(workload, nPcpus, currPcpu);
+}
+
+//always go to the least loaded pcpu regardless of the current pin
+int choosePcpuLeastLoaded(unsigned long long *workload, int nPcpus, int /*currPcpu*/)
+{
+	return getNextPcpuIndex(workload, nPcpus, 0);
+}
+
+//first entry is the active policy, the rest are shadow candidates
+static pinPolicy policies[] =
+{
+	{"sticky", choosePcpuSticky, true, {0}, {0}, NULL, 0},
+	{"least-loaded", choosePcpuLeastLoaded, false, {0}, {0}, NULL, 0},
+};
+static const int nPolicies = sizeof(policies) / sizeof(policies[0]);
+
+void initPolicyPins(pinPolicy *policy, int nDomains, virDomainWindow *domainWindows)
+{
+	policy->pins = (int**)calloc(nDomains, sizeof(int*));
+	for (int i = 0; i < nDomains; i++)
+	{
+		policy->pins[i] = (int*)malloc(domainWindows[i].nVcpus * sizeof(int));
+		for (int j = 0; j < domainWindows[i].nVcpus; j++)
+		{
+			policy->pins[i][j] = -1;
+		}
+	}
+}
+
+void destroyPolicyPins(pinPolicy *policy, int nDomains)
+{
+	if (policy->pins == NULL)
+	{
+		return;
+	}
+	for (int i = 0; i < nDomains; i++)
+	{
+		free(policy->pins[i]);
+	}
+	free(policy->pins);
+	policy->pins = NULL;
+}
+
 void printCpuMapping(int nDomains, virDomainWindow *domainWindows)
 {
 	virVcpuInfoPtr infoPtr = NULL; 
@@ -167,18 +229,21 @@ void printCpuMapping(int nDomains, virDomainWindow *domainWindows)
 	}
 }
 
-void setNewPinMappings(int nDomains, virDomainWindow *domainWindows)
+void setNewPinMappings(pinPolicy *policy, int nDomains, virDomainWindow *domainWindows)
 {
 	printf("=============================================\n");
-	printf("\n\nSetting new pin mappings\n");
+	printf("\n\nSetting new pin mappings (%s%s)\n", policy->name, policy->actuate ? "" : ", dry-run");
 	printf("\n-------------------------------------------\n");
 	
 	//copy cpu usage table to represent expected workload
 	unsigned long long expectedWorkload[MAX_CPUS];
-	memcpy(expectedWorkload, cpuTimes, MAX_CPUS);
+	memcpy(expectedWorkload, policy->cpuTimes, sizeof(expectedWorkload));
+	memset(policy->roundLoad, 0, sizeof(policy->roundLoad));
+	policy->nPins = 0;
 	//pin mapping bytes
 	unsigned char mappings[MAX_MAPPING_BYTES];
 	int pin = 0;
+	int currPin = 0;
 	int maxNPcpus = 0;
 
 	//go through each vcpu and map the pins
@@ -191,6 +256,12 @@ void setNewPinMappings(int nDomains, virDomainWindow *domainWindows)
 			printf("Vcpu%d:\n", domainWindows[i].currStats[j].number);
 			//clear mappings
 			memset(mappings, 0, VIR_CPU_MAPLEN(maxNPcpus));
+			//a policy that is not actuated never moved the vcpu, so start from where it would have put it
+			currPin = domainWindows[i].currStats[j].cpu;
+			if (policy->pins && policy->pins[i][j] >= 0)
+			{
+				currPin = policy->pins[i][j];
+			}
 			//skip pin mapping if there is no cpu usage difference
 			unsigned long long diff = domainWindows[i].currStats[j].cpuTime - domainWindows[i].prevStats[j].cpuTime;
 			if (diff == 0)
@@ -199,44 +270,113 @@ void setNewPinMappings(int nDomains, virDomainWindow *domainWindows)
 			}
 			//get next cpu pin, start at current pin setting. If it is unmapped during
 			//this round, keep it at this pin setting to avoid having to switch unneccessarily.
-			pin = getNextPcpuIndex(expectedWorkload, domainWindows[i].nPcpus, domainWindows[i].currStats[j].cpu);
+			pin = policy->choosePcpu(expectedWorkload, domainWindows[i].nPcpus, currPin);
 			expectedWorkload[pin] += diff;
-			cpuTimes[domainWindows[i].currStats[j].cpu] += diff;
+			policy->roundLoad[pin] += diff;
+			policy->cpuTimes[currPin] += diff;
+			if (policy->pins)
+			{
+				policy->pins[i][j] = pin;
+			}
 			//if calculated pin is the same as last pin mapped, skip the pin mapping
-			if (pin == domainWindows[i].currStats[j].cpu)
+			if (pin == currPin)
 			{
 				continue;
 			}
+			if (!policy->actuate)
+			{
+				policy->nPins++;
+				printf("[%s] would pin: vcpu%d -> pcpu%d\n", policy->name, domainWindows[i].currStats[j].number, pin);
+				continue;
+			}
 			printf("pin mapping: vcpu%d -> pcpu%d\n", domainWindows[i].currStats[j].number, pin);
 			mappings[pin/8] = 1 << (pin % 8);
 			if(virDomainPinVcpu(domainWindows[i].domain, domainWindows[i].currStats[j].number, mappings, VIR_CPU_MAPLEN(domainWindows[i].nPcpus)) < 0)
 			{
 				printf("Warning! Mapping did not succeed!\n");
 			}
+			else
+			{
+				policy->nPins++;
+			}
 			printf("maplen: %d\n", VIR_CPU_MAPLEN(domainWindows[i].nPcpus));
 		}
 		printf("\n-------------------------------------------\n");
 	}
-//	//update cpu usage table first
-//	for (int i = 0; i < nDomains; i++)
-//	{
-//		for(int j = 0; j < domainWindows[i].nVcpus; j++)
-//		{
-//			unsigned long long diff = domainWindows[i].currStats[j].cpuTime - domainWindows[i].prevStats[j].cpuTime;
-//		}
-//	}
+}
+
+//side by side report of the load each policy put on every pcpu this round
+void printPolicyReport(int nPcpus)
+{
+	printf("=============================================\n");
+	printf("Policy comparison (* = active):\n");
+	printf("\t");
+	for (int p = 0; p < nPolicies; p++)
+	{
+		printf("%s%s\t", policies[p].name, p == 0 ? "*" : "");
+	}
+	printf("\n---------------------------------------------\n");
+	for (int i = 0; i < nPcpus; i++)
+	{
+		printf("pcpu%d\t", i);
+		for (int p = 0; p < nPolicies; p++)
+		{
+			printf("%llu\t", policies[p].roundLoad[i]);
+		}
+		printf("\n");
+	}
+	//spread between the busiest and the idlest pcpu
+	printf("spread\t");
+	for (int p = 0; p < nPolicies; p++)
+	{
+		unsigned long long maxLoad = 0;
+		unsigned long long minLoad = ~0ULL;
+		for (int i = 0; i < nPcpus; i++)
+		{
+			maxLoad = policies[p].roundLoad[i] > maxLoad ? policies[p].roundLoad[i] : maxLoad;
+			minLoad = policies[p].roundLoad[i] < minLoad ? policies[p].roundLoad[i] : minLoad;
+		}
+		printf("%llu\t", nPcpus > 0 ? maxLoad - minLoad : 0);
+	}
+	printf("\npins\t");
+	for (int p = 0; p < nPolicies; p++)
+	{
+		printf("%d\t", policies[p].nPins);
+	}
+	printf("\n=============================================\n");
 }
 
 int main(int argc, char **argv)
 {
 	printf("max ull: %zu\n", sizeof(unsigned long long));
-	if (argc != 2)
+	if (argc < 2)
 	{
 		printf("wrong number of arguments...aborting.\n");
+		printf("usage: %s <period> [--dry-run] [--shadow]\n", argv[0]);
 		return -1;
 	}
 
 	int sleepTime = atoi(argv[1]);
+	//--dry-run: do not pin anything, only log what the active policy would do
+	//--shadow: also run the candidate policies and print a side by side report
+	bool shadow = false;
+	for (int i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--dry-run") == 0)
+		{
+			policies[0].actuate = false;
+		}
+		else if (strcmp(argv[i], "--shadow") == 0)
+		{
+			shadow = true;
+		}
+		else
+		{
+			printf("unknown option %s...aborting.\n", argv[i]);
+			return -1;
+		}
+	}
+	int nEvaluatedPolicies = shadow ? nPolicies : 1;
 
 	unsigned int flags = VIR_CONNECT_LIST_DOMAINS_RUNNING |
 				VIR_CONNECT_LIST_DOMAINS_PERSISTENT;
@@ -261,6 +401,16 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
+	//policies that are not actuated keep their own idea of where each vcpu is pinned
+	for (int p = 0; p < nEvaluatedPolicies; p++)
+	{
+		if (policies[p].actuate)
+		{
+			continue;
+		}
+		initPolicyPins(&policies[p], nDomains, domainWindows);
+	}
+
 	//initializes the beginning stats
 	if ((fetchStats(nDomains, domainWindows)) < 0)
 	{
@@ -283,15 +433,26 @@ int main(int argc, char **argv)
 			return -1;
 		}
 		
-		setNewPinMappings(nDomains, domainWindows);
+		for (int p = 0; p < nEvaluatedPolicies; p++)
+		{
+			setNewPinMappings(&policies[p], nDomains, domainWindows);
+		}
 		//print cpu usage table
 		printf("CPU Usage:\n");
 		for (int i = 0; i < domainWindows[0].nPcpus; i++)
 		{
-			printf("pcpu%d: %llu\n", i, cpuTimes[i]);
+			printf("pcpu%d: %llu\n", i, policies[0].cpuTimes[i]);
+		}
+		if (shadow)
+		{
+			printPolicyReport(domainWindows[0].nPcpus);
 		}
 	}
 
+	for (int p = 0; p < nEvaluatedPolicies; p++)
+	{
+		destroyPolicyPins(&policies[p], nDomains);
+	}
 	destroyDomainWindows(nDomains, domainWindows);
 	virConnectClose(conn);
 	return 0;
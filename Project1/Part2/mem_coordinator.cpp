@@ -14,6 +14,8 @@ struct virDomainWindow
 	//n*Stats represets number of valid stats.
 	int nPrevStats;
 	int nCurrStats;
+	//largest balloon the domain accepts, 0 if unknown
+	unsigned long maxMemory;
 	//historical and current memory stats
 	virDomainMemoryStatStruct prevStats[VIR_DOMAIN_MEMORY_STAT_NR];
 	virDomainMemoryStatStruct currStats[VIR_DOMAIN_MEMORY_STAT_NR];
@@ -39,6 +41,37 @@ static const unsigned int percentThreshold [] =
 	80	//HOT
 };
 
+//candidate thresholds, only evaluated in shadow mode
+static const unsigned int eagerThreshold [] =
+{
+	40,	//COLD
+	70	//HOT
+};
+
+//a memory policy. The active policy resizes balloons through virDomainSetMemory,
+//shadow policies run on the same stats but only log what they would have done.
+struct memPolicy
+{
+	const char *name;
+	const unsigned int *thresholds;
+	bool actuate;
+	//balloon size of each domain as this policy sees it. An actuated policy follows
+	//the live balloon, otherwise it is simulated across rounds, seeded from the live value.
+	unsigned long long *balloon;
+	//usage percentage of each domain in the previous round
+	int *prevUsage;
+	//number of domains resized in the last round
+	int nResized;
+};
+
+//first entry is the active policy, the rest are shadow candidates
+static memPolicy policies[] =
+{
+	{"default", percentThreshold, true, NULL, NULL, 0},
+	{"eager", eagerThreshold, false, NULL, NULL, 0},
+};
+static const int nPolicies = sizeof(policies) / sizeof(policies[0]);
+
 //static const unsigned int majorFaultThreshold [] =
 //{
 	
@@ -73,6 +106,10 @@ int initDomainWindows(virConnectPtr connection, virDomainWindow *&domainWindows)
 	for (int i = 0; i < nDomains; i++)
 	{
 		domainWindows[i].domain = domains[i];
+		if ((domainWindows[i].maxMemory = virDomainGetMaxMemory(domainWindows[i].domain)) == 0)
+		{
+			printf("Warning! Could not get max memory for domain %s.\n", virDomainGetName(domainWindows[i].domain));
+		}
 	}
 
 	return nDomains;
@@ -141,15 +178,13 @@ unsigned long long getDomainFreeTotal(int nDomains, virDomainWindow *domainWindo
 
 }
 
-//helper function - get the mem percentage for the particular statistic
-int getUsagePercentage(int nParams, virDomainMemoryStatPtr stats)
+//helper function - get the mem percentage of the used size against a balloon size
+int getUsagePercentage(unsigned long long usedSize, unsigned long long balloonSize)
 {
-	if (nParams == 0)
+	if (balloonSize == 0)
 	{
 		return 0;
 	}
-	unsigned long long balloonSize = getStatPtr(nParams, stats, VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON)->val;
-	unsigned long long usedSize = balloonSize - getStatPtr(nParams, stats, VIR_DOMAIN_MEMORY_STAT_UNUSED)->val;
 	int usagePercent = static_cast<int>((usedSize * 100.0)/balloonSize);
 	//printf("Used size: %llu\nBalloon size: %llu\n", usedSize, balloonSize);
 	//printf("Usage Percentage: %d\n", usagePercent);
@@ -212,8 +247,137 @@ int getHostMemoryStats(virConnectPtr connection, hostMemoryStat *hostStats)
 
 //int freeResourcesForHost(int nDomains
 
+//helper function - resize the domain balloon, or only log it if the policy is not actuated.
+//returns the virDomainSetMemory result, always 0 when not actuated.
+int setDomainMemory(memPolicy *policy, virDomainWindow *domainWindow, unsigned long long balloonSize, unsigned long long newSize)
+{
+	if (!policy->actuate)
+	{
+		printf("[%s] would set %s: %llu -> %llu\n", policy->name, virDomainGetName(domainWindow->domain), balloonSize, newSize);
+		return 0;
+	}
+	printf("%s: %llu -> %llu\n", virDomainGetName(domainWindow->domain), balloonSize, newSize);
+	int ret = virDomainSetMemory(domainWindow->domain, newSize);
+	if (ret < 0)
+	{
+		printf("Error %s the size of the domain memory.\n", newSize > balloonSize ? "doubling" : "halfing");
+	}
+	return ret;
+}
+
 //this is where logic for the memory policy is
-int adjustResources (virConnectPtr connection, int nDomains, virDomainWindow *domainWindows)
+void applyPolicy (memPolicy *policy, int hostUsagePercentage, int nDomains, virDomainWindow *domainWindows)
+{
+	policy->nResized = 0;
+	for (int i = 0; i < nDomains; i++)
+	{
+		virDomainMemoryStatPtr balloonStat = getStatPtr(domainWindows[i].nCurrStats, domainWindows[i].currStats, VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON);
+		virDomainMemoryStatPtr unusedStat = getStatPtr(domainWindows[i].nCurrStats, domainWindows[i].currStats, VIR_DOMAIN_MEMORY_STAT_UNUSED);
+		//skip domains that do not report balloon stats
+		if (balloonStat == NULL || unusedStat == NULL)
+		{
+			continue;
+		}
+		//memory the guest actually uses is the same whatever the policy did to the balloon
+		unsigned long long usedSize = balloonStat->val - unusedStat->val;
+		if (policy->actuate || policy->balloon[i] == 0)
+		{
+			policy->balloon[i] = balloonStat->val;
+		}
+		unsigned long long balloonSize = policy->balloon[i];
+		unsigned long long newSize = balloonSize;
+		int currPercentUsage = getUsagePercentage(usedSize, balloonSize);
+		int prevPercentUsage = policy->prevUsage[i];
+		policy->prevUsage[i] = currPercentUsage;
+
+		//if host memory usage (host + vm usage combined) is in the hot zone, adjust VM memory
+		//adjust all domains as soon as the host mem usage gets into the hot zone
+		if (hostUsagePercentage >= policy->thresholds[HOT])
+		{
+			//half the memory balloon of all VMs
+			newSize = balloonSize >> 1;
+		}
+
+		//otherwise, adjust VM memory:
+		//double or half the memory size if needed, this overrides the host adjustment
+		//only increase memory when two intervals of HOT memory usage occurs
+		if (currPercentUsage >= policy->thresholds[HOT] && prevPercentUsage >= policy->thresholds[HOT])
+		{
+			newSize = balloonSize << 1;
+		}
+		//only decrease memory when two intervals of COLDL memory usage occurs
+		else if (currPercentUsage <= policy->thresholds[COLD] && prevPercentUsage <= policy->thresholds[COLD])
+		{
+			newSize = balloonSize >> 1;
+		}
+		//virDomainSetMemory rejects anything above max memory, so never go past it
+		if (domainWindows[i].maxMemory != 0 && newSize > domainWindows[i].maxMemory)
+		{
+			newSize = domainWindows[i].maxMemory;
+		}
+
+		if (newSize == balloonSize)
+		{
+			continue;
+		}
+		if ((setDomainMemory(policy, &domainWindows[i], balloonSize, newSize)) < 0)
+		{
+			continue;
+		}
+		policy->balloon[i] = newSize;
+		policy->nResized++;
+	}
+}
+
+//side by side report of the balloon size each policy leaves every domain with.
+//Policies that are not actuated report their own simulated balloon, not a delta from the live one.
+void printPolicyReport(int nDomains, virDomainWindow *domainWindows)
+{
+	printf("======================================\n"
+		"Policy comparison (* = active):\n"
+		"======================================\n"
+		"domain\tcurrent\t");
+	for (int p = 0; p < nPolicies; p++)
+	{
+		printf("%s%s\t", policies[p].name, p == 0 ? "*" : "");
+	}
+	printf("\n--------------------------------------\n");
+	unsigned long long currentTotal = 0;
+	for (int i = 0; i < nDomains; i++)
+	{
+		virDomainMemoryStatPtr balloonStat = getStatPtr(domainWindows[i].nCurrStats, domainWindows[i].currStats, VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON);
+		if (balloonStat == NULL)
+		{
+			printf("%s\t-\n", virDomainGetName(domainWindows[i].domain));
+			continue;
+		}
+		currentTotal += balloonStat->val;
+		printf("%s\t%llu\t", virDomainGetName(domainWindows[i].domain), balloonStat->val);
+		for (int p = 0; p < nPolicies; p++)
+		{
+			printf("%llu\t", policies[p].balloon[i]);
+		}
+		printf("\n");
+	}
+	printf("total\t%llu\t", currentTotal);
+	for (int p = 0; p < nPolicies; p++)
+	{
+		unsigned long long total = 0;
+		for (int i = 0; i < nDomains; i++)
+		{
+			total += policies[p].balloon[i];
+		}
+		printf("%llu\t", total);
+	}
+	printf("\nresized\t\t");
+	for (int p = 0; p < nPolicies; p++)
+	{
+		printf("%d\t", policies[p].nResized);
+	}
+	printf("\n======================================\n");
+}
+
+int adjustResources (virConnectPtr connection, int nDomains, virDomainWindow *domainWindows, int nEvaluatedPolicies)
 {
 	//stats of all domains
 	unsigned long long domainBalloonTotal = getDomainBalloonTotal(nDomains, domainWindows);
@@ -252,59 +416,47 @@ int adjustResources (virConnectPtr connection, int nDomains, virDomainWindow *do
 		totalPhysicalMemory, totalPhysicalUnusedMemory, totalPhysicalUsedMemory,
 		totalNonDomainMemory, hostUsagePercentage);
 
-	//if host memory usage (host + vm usage combined) is in the hot zone, adjust VM memory
-	//adjust all domains as soon as the host mem usage gets into the hot zone
-	if (hostUsagePercentage >= percentThreshold[HOT])
+	for (int p = 0; p < nEvaluatedPolicies; p++)
 	{
-		//half the memory balloon of all VMs
-		for (int i = 0; i < nDomains; i++)
-		{
-			unsigned long long balloonSize = getStatPtr(domainWindows[i].nCurrStats, domainWindows[i].currStats, VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON)->val;
-			if ((virDomainSetMemory(domainWindows[i].domain, balloonSize >> 1)) < 0)
-			{
-				printf("Error halfing the size of the domain memory.\n");
-			}
-		}
+		applyPolicy(&policies[p], hostUsagePercentage, nDomains, domainWindows);
 	}
-	
-	//otherwise, adjust VM memory:
-	//Go through each domain and double or half the memory size if needed 
-	for (int i = 0; i < nDomains; i++)
+	if (nEvaluatedPolicies > 1)
 	{
-		int currPercentUsage = getUsagePercentage(domainWindows[i].nCurrStats, domainWindows[i].currStats);
-		int prevPercentUsage = getUsagePercentage(domainWindows[i].nPrevStats, domainWindows[i].prevStats);
-		unsigned long long balloonSize = getStatPtr(domainWindows[i].nCurrStats, domainWindows[i].currStats, VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON)->val;
-		//only increase memory when two intervals of HOT memory usage occurs
-		if (currPercentUsage >= percentThreshold[HOT] && prevPercentUsage >= percentThreshold[HOT])
-		{
-			printf("%s: %llu -> %llu\n", virDomainGetName(domainWindows[i].domain), balloonSize, balloonSize << 1);
-			if ((virDomainSetMemory(domainWindows[i].domain, balloonSize << 1)) < 0)
-			{
-				printf("Error doubling the size of the domain memory.\n");
-			}
-		}
-		//only decrease memory when two intervals of COLDL memory usage occurs
-		else if (currPercentUsage <= percentThreshold[COLD] && prevPercentUsage <= percentThreshold[COLD])
-		{
-			printf("%s: %llu -> %llu\n", virDomainGetName(domainWindows[i].domain), balloonSize, balloonSize >> 1);
-			if((virDomainSetMemory(domainWindows[i].domain, balloonSize >> 1)) < 0)
-			{
-				printf("Error halfing the size of the domain memory.\n");
-			}
-		}
+		printPolicyReport(nDomains, domainWindows);
 	}
 	return 0;
 }
 
 int main(int argc, char **argv)
 {
-	if (argc != 2)
+	if (argc < 2)
 	{
 		printf("wrong number of arguments...aborting.\n");
+		printf("usage: %s <period> [--dry-run] [--shadow]\n", argv[0]);
 		return -1;
 	}
 
 	int period = atoi(argv[1]);
+	//--dry-run: do not resize anything, only log what the active policy would do
+	//--shadow: also run the candidate policies and print a side by side report
+	bool shadow = false;
+	for (int i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--dry-run") == 0)
+		{
+			policies[0].actuate = false;
+		}
+		else if (strcmp(argv[i], "--shadow") == 0)
+		{
+			shadow = true;
+		}
+		else
+		{
+			printf("unknown option %s...aborting.\n", argv[i]);
+			return -1;
+		}
+	}
+	int nEvaluatedPolicies = shadow ? nPolicies : 1;
 
 	printf("period: %d\n", period);
 	unsigned int flags = VIR_CONNECT_LIST_DOMAINS_RUNNING |
@@ -338,6 +490,12 @@ int main(int argc, char **argv)
 		virConnectClose(conn);
 		return 0;
 	}
+	for (int p = 0; p < nEvaluatedPolicies; p++)
+	{
+		policies[p].balloon = (unsigned long long*)calloc(nDomains, sizeof(unsigned long long));
+		policies[p].prevUsage = (int*)calloc(nDomains, sizeof(int));
+	}
+
 	//set the statistics gathering interval for each domain
 	for (int i = 0; i < nDomains; i++)
 	{
@@ -360,7 +518,7 @@ int main(int argc, char **argv)
 				"Domain: %s\n", virDomainGetName(domainWindows[i].domain));
 			printStats(domainWindows[i].nCurrStats, domainWindows[i].currStats);
 		}
-		if ((adjustResources(conn, nDomains, domainWindows)) < 0)
+		if ((adjustResources(conn, nDomains, domainWindows, nEvaluatedPolicies)) < 0)
 		{
 			printf("Error adjusting domain memory resources. Aborting.\n");
 			virConnectClose(conn);